@@ -0,0 +1,31 @@
+#*********************************************************************************************************************
+#  Compare benchmark result with baseline, fail on any metric more than tol percent slower
+#
+#  Usage: awk -v tol=2 -f compare.awk baseline.txt result.txt
+#*********************************************************************************************************************
+#
+
+/^#/ { next }                                    # Tool versions
+FNR == NR { keys[++nk] = $1; base[$1] = $2; next }
+{ got[$1] = $2 }
+
+END {
+   fail = 0
+   for (i = 1; i <= nk; i++)
+   {
+      k = keys[i]
+      if (!(k in got))
+      {
+         printf "%-20s %10d  %10s  MISSING\n", k, base[k], "-"
+         fail = 1
+      }
+      else if (got[k] > base[k] * (100 + tol) / 100)
+      {
+         printf "%-20s %10d  %10d  SLOWER\n", k, base[k], got[k]
+         fail = 1
+      }
+      else
+         printf "%-20s %10d  %10d  ok\n", k, base[k], got[k]
+   }
+   exit fail
+}
@@ -0,0 +1,155 @@
+#*********************************************************************************************************************
+#  Reduce gpsim output from run_bench.sh to "metric cycles" lines
+#
+#  @sym name  is followed by the symbol value, @hit by cycles, pc and bPortA. Values are taken after the first '='.
+#  Blocking time of vBeep / vLongDelay runs from entry to the next hit, which is within a few dozen cycles of the
+#  return since neither routine writes bPortA. Relay events are taken from the bPortA shadow, not the pins, and
+#  timed at the write hit whether gpsim halts before or after the write: if the new value shows on a later hit,
+#  the last write hit before it is used.
+#  With probe=1 only the shortest main loop pass is printed. Exits non-zero when a routine symbol, a main loop
+#  pass, a vBeep / vLongDelay call or a relay event is missing, so no metric is ever stored as 0.
+#*********************************************************************************************************************
+#
+
+function num(s,   i, r)
+{
+   if (s ~ /^0[xX]/)
+   {
+      s = tolower(substr(s, 3))
+      r = 0
+      for (i = 1; i <= length(s); i++)
+         r = r * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1
+      return r
+   }
+   return s + 0
+}
+
+function val(   s, a)
+{
+   s = $0
+   if (s ~ /=/)
+   {
+      sub(/^[^=]*=[ \t]*/, "", s)
+      split(s, a, /[ \t]/)
+      return num(a[1])
+   }
+   match(s, /0[xX][0-9a-fA-F]+|[0-9]+/)        # Bare value
+   return num(substr(s, RSTART, RLENGTH))
+}
+
+function bit(v, n)
+{
+   return int(v / (2 ^ n)) % 2
+}
+
+function hit(c, pc, pa)
+{
+   if (done)
+      return
+   if (c >= end && !probe)
+   {
+      done = 1
+      return
+   }
+
+   if (blk != "")
+   {
+      if (c - blk_at > worst[blk])
+         worst[blk] = c - blk_at
+      blk = ""
+   }
+
+   if (pc == sym["_vButtonpoll"])
+   {
+      if (poll_at)
+      {
+         if (!loop_min || c - poll_at < loop_min)
+            loop_min = c - poll_at
+         if (c - poll_at > loop_max)
+            loop_max = c - poll_at
+      }
+      poll_at = c
+   }
+   else if (pc == sym["_vBeep"] || pc == sym["_vLongDelay"])
+   {
+      blk = (pc == sym["_vBeep"]) ? "beep" : "longdelay"
+      blk_at = c
+   }
+   else
+      wr = 1
+
+   # Lights relay RA0, relay 1 RA1
+   at = wr ? c : wr_at
+   if (!("lights_on" in seen) && c >= lights_on && c < lights_off && bit(pa, 0))
+      seen["lights_on"] = at - lights_on
+   if (!("lights_off" in seen) && c >= lights_off && !bit(pa, 0))
+      seen["lights_off"] = at - lights_off
+   if (!("acc_commit" in seen) && c >= acc && bit(pa, 1))
+      seen["acc_commit"] = at - acc
+   if (wr)
+      wr_at = c
+   wr = 0
+}
+
+/@sym / && !/echo/ { name = $2; want = "sym"; next }
+/@hit/ && !/echo/ { n = 0; want = "hit"; next }
+
+want == "sym" && /[0-9]/ { sym[name] = val(); want = ""; next }
+want == "hit" && /[0-9]/ {
+   v[n++] = val()
+   if (n == 3)
+   {
+      hit(v[0], v[1], v[2])
+      want = ""
+   }
+   next
+}
+
+END {
+   if (sym["_vButtonpoll"] == "" || (!probe && (sym["_vBeep"] == "" || sym["_vLongDelay"] == "")))
+   {
+      print "parse.awk: routine symbol not resolved, check gpsim output" > "/dev/stderr"
+      exit 1
+   }
+   if (probe)
+   {
+      if (!loop_min)
+      {
+         print "parse.awk: no main loop pass in probe run, check gpsim output" > "/dev/stderr"
+         exit 1
+      }
+      print loop_min
+      exit 0
+   }
+   if (!done)
+   {
+      print "parse.awk: simulation did not reach END, raise RUNS or check gpsim output" > "/dev/stderr"
+      exit 1
+   }
+   split("lights_on lights_off acc_commit", ev, " ")
+   for (i = 1; i <= 3; i++)
+      if (!(ev[i] in seen))
+      {
+         print "parse.awk: " ev[i] " relay event not seen before END" > "/dev/stderr"
+         exit 1
+      }
+   if (!loop_min)
+   {
+      print "parse.awk: no main loop pass measured before END" > "/dev/stderr"
+      exit 1
+   }
+   split("beep longdelay", ev, " ")
+   for (i = 1; i <= 2; i++)
+      if (!(ev[i] in worst))
+      {
+         print "parse.awk: " ev[i] " routine not entered and left before END" > "/dev/stderr"
+         exit 1
+      }
+   printf "loop_min %d\n", loop_min
+   printf "loop_max %d\n", loop_max
+   printf "beep_max %d\n", worst["beep"]
+   printf "longdelay_max %d\n", worst["longdelay"]
+   printf "lights_on_latency %d\n", seen["lights_on"]
+   printf "lights_off_latency %d\n", seen["lights_off"]
+   printf "acc_commit %d\n", seen["acc_commit"]
+}
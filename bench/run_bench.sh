@@ -0,0 +1,107 @@
+#!/bin/sh
+#*********************************************************************************************************************
+#  Run the firmware image in gpsim with scripted switch stimulus, print cycle metrics
+#
+#  Usage: run_bench.sh image.cof > result.txt
+#
+#  Breakpoints on vButtonpoll, vBeep, vLongDelay entry and on writes to the bPortA shadow. After each hit the
+#  script prints cycles, pc and bPortA, parse.awk turns the hits into metrics. All times in instruction cycles.
+#  A short probe run measures the main loop period first, the number of hits to step through is sized from it.
+#*********************************************************************************************************************
+#
+
+set -e
+
+COF=$1
+GPSIM=${GPSIM:-gpsim}
+PROBE=64                            # Main loop passes in probe run
+
+# Scenario, instruction cycles. Startup delays end at about 3.8M
+START=4000000                       # Breakpoints set
+LIGHTS_ON=4500000                   # RB6 lights switch press, lights relay on
+LIGHTS_ON_UP=4800000
+VALET=5500000                       # RB5 valet switch press (active low)
+VALET_UP=5800000
+DOORS=6500000                       # RB4 doors open
+DOORS_UP=7500000
+ACC=8500000                         # RA5 accessory switch press, relay 1 commits after delay
+ACC_UP=8800000
+LIGHTS_OFF=18000000                 # RB6 lights switch press, lights relay off
+LIGHTS_OFF_UP=18300000
+END=20000000
+
+if [ ! -f "$COF" ]; then
+   echo "run_bench.sh: no image $COF" >&2
+   exit 1
+fi
+
+DIR=$(dirname "$0")
+STC=$(mktemp)
+LOG=$(mktemp)
+trap 'rm -f "$STC" "$LOG"' EXIT
+
+stim()
+{
+   # stim name pin initial_state {cycle, state, ...}
+   cat <<STIM
+stimulus asynchronous_stimulus
+initial_state $3
+start_cycle 0
+period $((END * 2))
+{ $4 }
+name $1
+end
+node n_$1
+attach n_$1 $1 $2
+STIM
+}
+
+script()
+{
+   # script hits
+   echo "load p16f628a $COF"
+   stim lights_stim portb6 0 "$LIGHTS_ON, 1, $LIGHTS_ON_UP, 0, $LIGHTS_OFF, 1, $LIGHTS_OFF_UP, 0"
+   stim valet_stim portb5 1 "$VALET, 0, $VALET_UP, 1"
+   stim doors_stim portb4 0 "$DOORS, 1, $DOORS_UP, 0"
+   stim acc_stim porta5 0 "$ACC, 1, $ACC_UP, 0"
+
+   echo "break c $START"
+   echo "run"
+   for S in _vButtonpoll _vBeep _vLongDelay; do
+      echo "echo @sym $S"
+      echo "$S"
+   done
+   echo "break e _vButtonpoll"
+   echo "break e _vBeep"
+   echo "break e _vLongDelay"
+   echo "break w _bPortA"
+   echo "break c $END"
+
+   I=0
+   while [ $I -lt $1 ]; do
+      echo "run"
+      echo "echo @hit"
+      echo "cycles"
+      echo "pc"
+      echo "_bPortA"
+      I=$((I + 1))
+   done
+   echo "quit"
+}
+
+simulate()
+{
+   # simulate hits
+   script $1 > "$STC"
+   "$GPSIM" -i -c "$STC" > "$LOG" 2>&1 || true
+}
+
+# Probe: shortest main loop pass bounds the number of vButtonpoll hits up to END
+simulate $PROBE
+LOOP=$(awk -v probe=1 -v end=$END -f "$DIR/parse.awk" "$LOG")
+
+# Every pass is at least LOOP cycles, writes and beep / delay entries add a few hundred hits
+RUNS=$(((END - START) / LOOP * 5 / 4 + 1000))
+simulate $RUNS
+awk -v end=$END -v lights_on=$LIGHTS_ON -v lights_off=$LIGHTS_OFF -v acc=$ACC \
+   -f "$DIR/parse.awk" "$LOG"
@@ -56,6 +56,24 @@
 #define MAX_SW          0xA0              // Max switch counter value
 #define MAX_BLINKPACE   0x04B0            // Blinkcheck pace       
 
+// Auto-off
+// #define IGN_SENSE                      // Ignition sense wired, hold auto-off timers while ignition is on
+#define IGN_SW          0x10              // (4)In:  Ignition sense in (IGN_SENSE only, replaces doors switch)
+#define EE_AUTO_MIN     0x00              // EEPROM: auto-off minutes, lights, relay 1, relay 2, relay 3 (0 = never)
+#define TMR1_PRELOAD_H  0x0B              // Timer1 preload, 62500 counts at Fosc/4 1:8 = 0.5 s tick
+#define TMR1_PRELOAD_L  0xDC
+#define TICKS_PER_MIN   120               // Auto-off ticks per minute
+#define AUTO_WARN       60                // Ticks left when warning is given (30 s)
+
+// Self-test
+// #define TEST_SERIAL                    // Self-test result also on USART TX (RB2, doors switch light)
+#define TEST_OUTPUTS    12                // Fail codes 1 - 12: output in test order
+#define TEST_VALET      13                // Fail code: valet switch not read as held
+#define TEST_LIGHTS     14                // Fail code: lights switch stuck
+#define TEST_ACC        15                // Fail code: accessory switch stuck
+#define TEST_DOORS      16                // Fail code: doors switch stuck
+#define TEST_EEPROM     17                // Fail code: EEPROM not programmed
+
 typedef unsigned char BYTE;
 
 //*********************************************************************************************************************
@@ -96,6 +114,20 @@ BYTE              bBlinkstate = 0x00;                  // Blink state
 unsigned long     ulBlinkpace = 0x0000;                // Blink pacer
 unsigned long     ulAcc = 0x0000;                      // Acc delay counter
 
+// Auto-off timers
+BYTE              bAuto_min[4];                        // Auto-off minutes from EEPROM (lights, relay 1, 2, 3)
+unsigned int      uiLights_off = 0x0000;               // Lights auto-off ticks left (0 = not running)
+unsigned int      uiAcc_off = 0x0000;                  // Acc auto-off ticks left (0 = not running)
+BYTE              bTicks = 0x00;                       // Auto-off ticks not yet handled
+
+// Default auto-off minutes, programmed with the image. Without ignition sense the timers would also run while
+// driving, so they stay disabled unless set in EEPROM
+#ifdef IGN_SENSE
+__EEPROM_DATA(30, 60, 60, 60, 0, 0, 0, 0);
+#else
+__EEPROM_DATA(0, 0, 0, 0, 0, 0, 0, 0);
+#endif
+
 
 //*********************************************************************************************************************
 // 
@@ -104,6 +136,7 @@ unsigned long     ulAcc = 0x0000;                      // Acc delay counter
 
 void init_ports(void) 
 {
+   CMCON = 0x07;              // Comparators off, RA0-3 digital (read back in vTest)
    TRISA = 0x20;
    TRISB = 0x70;
    PORTA = 0x10;              // Red LED off (OC))
@@ -147,6 +180,26 @@ void vShortDelay(unsigned long ulD)
 }
 */
  
+//*********************************************************************************************************************
+//  Count Timer1 overflow as auto-off tick. Preload is added to the running count so no time is lost 
+//*********************************************************************************************************************
+//
+ 
+void vTick(void) 
+{
+   unsigned char                 ucL                  = 0;
+   
+   if (!(PIR1 & 0x01))        // No overflow yet
+      return;
+   
+   ucL = TMR1L;
+   TMR1L = (unsigned char)(ucL + TMR1_PRELOAD_L);
+   TMR1H = (unsigned char)(TMR1H + TMR1_PRELOAD_H + ((unsigned char)(ucL + TMR1_PRELOAD_L) < ucL));
+   PIR1 &= (unsigned char)(~0x01);
+   if (bTicks < 0xFF)
+      bTicks++;
+}
+
 //*********************************************************************************************************************
 //  
 //*********************************************************************************************************************
@@ -159,6 +212,7 @@ void vLongDelay(unsigned long ulD)
    for (i = 0; i < ulD; i++)
    {  
       asm("CLRWDT");
+      vTick();
       __delay_ms(100);
    }   
 }
@@ -360,6 +414,24 @@ void vButtonpoll(void)
    }   
 }
 
+//*********************************************************************************************************************
+//  Restart auto-off timers from current output state 
+//*********************************************************************************************************************
+//
+
+void vAutoreload(void) 
+{
+   if (bLights_state)
+      uiLights_off = (unsigned int)(bAuto_min[0] * TICKS_PER_MIN);
+   else
+      uiLights_off = 0;
+   
+   if ((bAcc_state2 == 1) && bAcc_state)
+      uiAcc_off = (unsigned int)(bAuto_min[bAcc_state] * TICKS_PER_MIN);
+   else
+      uiAcc_off = 0;
+}
+
 //*********************************************************************************************************************
 // 
 //*********************************************************************************************************************
@@ -387,6 +459,7 @@ void vButtonaction(void)
          bLights_state = 1;
          vToggle(RELAY_LIGHTS, ON);
       }         
+      vAutoreload();
    }
 
    // Accessories *********************************************
@@ -407,6 +480,7 @@ void vButtonaction(void)
          vToggle(RELAY_1, OFF);
          vToggle(RELAY_2, OFF);
          vToggle(RELAY_3, OFF);                                
+         vAutoreload();
       }     
       else     // Not committed yet
       {
@@ -468,6 +542,7 @@ void vButtonaction(void)
             vToggle(RELAY_3, ON);
          }   
          vBeep(2);           
+         vAutoreload();
       }
    }
    
@@ -482,8 +557,10 @@ void vButtonaction(void)
       vBeep(2);
       vSlowBlink(VALET_S_L, 10);  
       bValet_oldhold = bValet_hold;
+      vAutoreload();
    }
    
+#ifndef IGN_SENSE
    // Doors
    if (bDoors_hold & (!bDoors_oldhold))
    {     
@@ -491,13 +568,16 @@ void vButtonaction(void)
       vFastBlink(DOORS_S_L, 8);
       bDoors_state = 0;
       bDoors_oldhold = bDoors_hold;
+      vAutoreload();
    }   
    else if ((!bDoors_hold) & bDoors_oldhold)
    {  
       vBeep(3);
       vSlowBlink(DOORS_S_L, 3);
       bDoors_oldhold = bDoors_hold;
+      vAutoreload();
    }                     
+#endif
 }
 
 //*********************************************************************************************************************
@@ -577,40 +657,206 @@ void vBlinkcheck(void)
 }
 
 //*********************************************************************************************************************
-// 
+//  Load auto-off minutes and start the 0.5 s tick on Timer1 
+//*********************************************************************************************************************
+//
+
+void vAutoinit(void) 
+{
+   unsigned char                 i                    = 0;
+   
+   for (i = 0; i < 4; i++)
+      bAuto_min[i] = eeprom_read((unsigned char)(EE_AUTO_MIN + i));
+   
+   T1CON = 0x30;              // Fosc/4, 1:8, stopped
+   TMR1H = TMR1_PRELOAD_H;
+   TMR1L = TMR1_PRELOAD_L;
+   PIR1 &= (unsigned char)(~0x01);
+   T1CON |= 0x01;             // Run
+}
+
+//*********************************************************************************************************************
+//  Auto-off tick, polled from main loop, one pending tick per pass. Switch off lights and accessories left on when parked 
+//  A valet switch press restarts the timers without changing any output, use it to extend during the warning 
+//*********************************************************************************************************************
+//
+
+void vAutooff(void) 
+{
+   vTick();
+   if (!bTicks)               // No tick pending
+      return;
+   bTicks--;
+   
+#ifdef IGN_SENSE
+   if (PORTB & IGN_SW)        // Ignition on, hold timers
+   {
+      vAutoreload();
+      return;
+   }
+#endif
+   
+   // Lights **************************************************
+   if (uiLights_off)
+   {
+      uiLights_off--;
+      if (uiLights_off == AUTO_WARN)
+      {
+         vBeep(1);
+         vSlowBlink(LIGHTS_S_L, 10);
+      }
+      else if (!uiLights_off)
+      {
+         vBeep(3);
+         vSlowBlink(LIGHTS_S_L, 2);
+         bLights_state = 0;
+         vToggle(RELAY_LIGHTS, OFF);
+      }
+   }
+   
+   // Accessories *********************************************
+   if (uiAcc_off)
+   {
+      uiAcc_off--;
+      if (uiAcc_off == AUTO_WARN)
+      {
+         vBeep(1);
+         vSlowBlink(ACC_S_L, 10);
+      }
+      else if (!uiAcc_off)
+      {
+         vToggle(LED_1, OFF); vToggle(LED_2, OFF); vToggle(LED_3, OFF);
+         vBeep(3);
+         bAcc_state = 0;
+         bAcc_state2 = 0;
+         vToggle(RELAY_1, OFF);
+         vToggle(RELAY_2, OFF);
+         vToggle(RELAY_3, OFF);
+      }
+   }
+}
+
+//*********************************************************************************************************************
+//  Read back output pin level 
+//*********************************************************************************************************************
+//
+
+BYTE bReadback(unsigned char ucI)
+{
+   if ((ucI & LIGHTS_SW) && (ucI & 0b10111111))  // Port B
+      return (BYTE)(PORTB & (ucI & 0b10111111));
+   else
+      return (BYTE)(PORTA & ucI);
+}
+
+#ifdef TEST_SERIAL
+//*********************************************************************************************************************
+//  Self-test result on USART TX, 9600 8N1 
+//*********************************************************************************************************************
+//
+
+void vTestsend(unsigned char ucF)
+{
+   char                          cMsg[10];
+   unsigned char                 i                    = 0;
+   
+   if (ucF)
+   {
+      strcpy(cMsg, "FAIL nn\r\n");
+      cMsg[5] = (char)('0' + ucF / 10);
+      cMsg[6] = (char)('0' + ucF % 10);
+   }
+   else
+      strcpy(cMsg, "PASS\r\n");
+   
+   TRISB |= 0x06;             // RB1/RB2 to USART
+   SPBRG = 25;                // 9600 at 4 MHz, BRGH
+   TXSTA = 0x24;              // TXEN, BRGH
+   RCSTA = 0x80;              // SPEN
+   for (i = 0; cMsg[i]; i++)
+   {
+      while (!(PIR1 & 0x10))  // TXIF
+         ;
+      TXREG = (unsigned char)cMsg[i];
+   }
+   while (!(TXSTA & 0x02))    // TRMT, let last byte out
+      ;
+}
+#endif
+
+//*********************************************************************************************************************
+//  End-of-line self-test. Every output pulsed once and read back, inputs checked, result shown until power off 
+//  Pass: LED 2 on and beep. Fail: LED 1 blinks fail code, about 0.3 s on / 0.3 s off, 1.5 s between repeats
+//  (vLongDelay step is 25 ms real, _XTAL_FREQ is set to 1 MHz with the 4 MHz internal oscillator) 
 //*********************************************************************************************************************
 //
 
 void vTest(void) 
 {
-   int                           bBusy                = 1;
+   static const BYTE             bOut[TEST_OUTPUTS]   = { LED_1, LED_2, LED_3, RELAY_LIGHTS, RELAY_1, RELAY_2, RELAY_3,
+                                                          LIGHTS_S_L, ACC_S_L, DOORS_S_L, VALET_S_L, SPEAKER };
+   unsigned char                 ucF                  = 0;     // First failing step, 0 = pass
+   unsigned char                 i                    = 0;
 
-   vLongDelay(80);  
-   while (bBusy)                     // Run until power off 
+   __delay_ms(20);
+   
+   // Outputs, codes 1 - 12
+   for (i = 0; i < TEST_OUTPUTS; i++)
    {
-      vBeep(0);
-      asm("CLRWDT");
-      vBlink(LED_1, 1);  
-      asm("CLRWDT");
-      vBeep(1);
       asm("CLRWDT");
-      vBlink(LED_2, 1);            
+      vToggle(bOut[i], ON);
+      __delay_ms(40);
+      if ((bOut[i] != LED_1) && !bReadback(bOut[i]) && !ucF)     // LED 1 is open drain, no readback
+         ucF = (unsigned char)(i + 1);
+      vToggle(bOut[i], OFF);
+      __delay_ms(10);
+      if ((bOut[i] != LED_1) && bReadback(bOut[i]) && !ucF)
+         ucF = (unsigned char)(i + 1);
+   }
+   
+   // Inputs, valet held to get here, the rest released
+   if ((PORTB & 0x20) && !ucF)     // RB5 alone, VALET_SW carries the port B marker bit
+      ucF = TEST_VALET;
+   if ((PORTB & LIGHTS_SW) && !ucF)
+      ucF = TEST_LIGHTS;
+   if ((PORTA & ACC_SW) && !ucF)
+      ucF = TEST_ACC;
+#ifndef IGN_SENSE
+   if ((PORTB & 0x10) && !ucF)
+      ucF = TEST_DOORS;
+#endif
+   
+   // EEPROM programmed
+   for (i = 0; i < 4; i++)
+      if ((bAuto_min[i] == 0xFF) && !ucF)
+         ucF = TEST_EEPROM;
+
+#ifdef TEST_SERIAL
+   vTestsend(ucF);
+#endif
+   
+   if (!ucF)
+   {
+      vToggle(LED_2, ON);
       vBeep(2);
+   }
+   else
+      vBeep(1);
+   
+   while (1)                  // Hold result until power off 
+   {
       asm("CLRWDT");
-      vBlink(LED_3, 1);       
-      vBeep(3);
-      vBlink(LIGHTS_S_L, 2);             
-      vBlink(ACC_S_L, 2);       
-      asm("CLRWDT");
-      vBlink(VALET_S_L, 2);       
-      vBlink(DOORS_S_L, 2);   
-      asm("CLRWDT");
-      vBlink(RELAY_LIGHTS, 2);            
-      asm("CLRWDT");
-      vBlink(RELAY_1, 2);       
-      vBlink(RELAY_2, 2);       
-      asm("CLRWDT");
-      vBlink(RELAY_3, 2);                       
+      if (ucF)
+      {
+         for (i = 0; i < ucF; i++)
+         {
+            vToggle(LED_1, ON);
+            vLongDelay(12);
+            vToggle(LED_1, OFF);
+            vLongDelay(12);
+         }
+         vLongDelay(60);
+      }
    }
 }
 
@@ -630,13 +876,12 @@ void main()
    INTCON = 0x00;
    PIE1 = 0x00;
    PIR1 = 0x00; 
-   
-   //CMCON = 0x07;
      
    // Configure ports
    init_ports();
    vToggle(LED_1, OFF); 
    vToggle(LIGHTS_S_L, OFF); 
+   vAutoinit();
    
    // Check for test routine
    if (!(PORTB & VALET_SW))
@@ -658,6 +903,7 @@ void main()
       vButtonpoll();
       vButtonaction();     
       vBlinkcheck();
+      vAutooff();
       asm("CLRWDT");                   
    }   
   